@@ -16,10 +16,17 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    eventlog.cpp \
+    governor.cpp \
     main.cpp \
+    memoryguard.cpp \
     widget.cpp
 
 HEADERS += \
+    classify.h \
+    eventlog.h \
+    governor.h \
+    memoryguard.h \
     widget.h \
     tensorflow.h
 
@@ -45,16 +52,8 @@ LIBS += -ltensorflow-lite -ldl
 INCLUDEPATH += /usr/local/include/opencv4 \
                 /usr/local/include/opencv4/opencv2
 
-LIBS += /usr/local/lib/libopencv_calib3d.so \
-        /usr/local/lib/libopencv_core.so \
-        /usr/local/lib/libopencv_features2d.so \
-        /usr/local/lib/libopencv_flann.so \
-        /usr/local/lib/libopencv_highgui.so \
+# 只链接用到的模块：VideoCapture 需要 videoio 及其依赖
+LIBS += /usr/local/lib/libopencv_core.so \
         /usr/local/lib/libopencv_imgcodecs.so \
         /usr/local/lib/libopencv_imgproc.so \
-        /usr/local/lib/libopencv_ml.so \
-        /usr/local/lib/libopencv_objdetect.so \
-        /usr/local/lib/libopencv_photo.so \
-        /usr/local/lib/libopencv_stitching.so \
-        /usr/local/lib/libopencv_videoio.so \
-        /usr/local/lib/libopencv_video.so \
+        /usr/local/lib/libopencv_videoio.so
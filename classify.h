@@ -0,0 +1,179 @@
+/*
+ *  Copyright (C) 2021 刘臣轩
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+// 识别流程中与界面无关的部分，供 Widget 与 tools/evaluate 共用
+
+#include <QImage>
+#include <QString>
+
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+#include "tensorflow.h"
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+// labels.txt 中的编号 -> 垃圾类别
+inline QString cateName(int index)
+{
+    switch (index) {
+    case 1:case 2:case 10:
+        return "有害垃圾";
+    case 3:case 4:case 5:case 11:
+        return "可回收垃圾";
+    case 6:case 7:case 12:case 13:
+        return "厨余垃圾";
+    case 8:case 9:
+        return "其他垃圾";
+    default:
+        return "识别失败";
+    }
+}
+
+// 缩放用的解释器 resizer 由调用方持有，只在输入尺寸变化时重建，避免每帧重新分配整幅图片大小的张量
+template <class T>
+void formatImageTFLite(std::unique_ptr<tflite::Interpreter>& resizer, T* out, const uint8_t* in, int image_height, int image_width, int image_channels, int wanted_height, int wanted_width, int wanted_channels, bool input_floating)
+{
+   const float input_mean = 127.5f;
+   const float input_std  = 127.5f;
+
+  int number_of_pixels = image_height * image_width * image_channels;
+
+  TfLiteIntArray* dims = resizer ? resizer->tensor(0)->dims : nullptr;
+  if (!dims || dims->data[1] != image_height || dims->data[2] != image_width || dims->data[3] != image_channels
+      || resizer->tensor(2)->dims->data[1] != wanted_height || resizer->tensor(2)->dims->data[2] != wanted_width) {
+    resizer.reset(new tflite::Interpreter);
+
+    int base_index = 0;
+
+    // two inputs: input and new_sizes
+    resizer->AddTensors(2, &base_index);
+
+    // one output
+    resizer->AddTensors(1, &base_index);
+
+    // set input and output tensors
+    resizer->SetInputs({0, 1});
+    resizer->SetOutputs({2});
+
+    // set parameters of tensors
+    TfLiteQuantizationParams quant;
+    resizer->SetTensorParametersReadWrite(0, kTfLiteFloat32, "input",    {1, image_height, image_width, image_channels}, quant);
+    resizer->SetTensorParametersReadWrite(1, kTfLiteInt32,   "new_size", {2},quant);
+    resizer->SetTensorParametersReadWrite(2, kTfLiteFloat32, "output",   {1, wanted_height, wanted_width, wanted_channels}, quant);
+
+    tflite::ops::builtin::BuiltinOpResolver resolver;
+    const TfLiteRegistration *resize_op = resolver.FindOp(tflite::BuiltinOperator_RESIZE_BILINEAR,1);
+    // params is owned and freed by the interpreter
+    auto* params = reinterpret_cast<TfLiteResizeBilinearParams*>(malloc(sizeof(TfLiteResizeBilinearParams)));
+    params->align_corners = false;
+    resizer->AddNodeWithParameters({0, 1}, {2}, nullptr, 0, params, resize_op, nullptr);
+    resizer->AllocateTensors();
+  }
+
+  // fill input image
+  // in[] are integers, cannot do memcpy() directly
+  auto input = resizer->typed_tensor<float>(0);
+  for (int i = 0; i < number_of_pixels; i++)
+    input[i] = in[i];
+
+  // fill new_sizes
+  resizer->typed_tensor<int>(1)[0] = wanted_height;
+  resizer->typed_tensor<int>(1)[1] = wanted_width;
+
+  resizer->Invoke();
+
+  auto output = resizer->typed_tensor<float>(2);
+  auto output_number_of_pixels = wanted_height * wanted_height * wanted_channels;
+
+  for (int i = 0; i < output_number_of_pixels; i++)
+  {
+    if (input_floating)
+      out[i] = (output[i] - input_mean) / input_std;
+    else
+      out[i] = (uint8_t)output[i];
+  }
+}
+
+template <class T>
+void get_top_n(T* prediction, int prediction_size, size_t num_results,
+               float threshold, std::vector<std::pair<float, int>>* top_results,
+               TfLiteType input_type) {
+  // Will contain top N results in ascending order.
+  std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int>>,
+                      std::greater<std::pair<float, int>>>
+      top_result_pq;
+
+  const long count = prediction_size;  // NOLINT(runtime/int)
+  float value = 0.0;
+
+  for (int i = 0; i < count; ++i) {
+    switch (input_type) {
+      case kTfLiteFloat32:
+        value = prediction[i];
+        break;
+      case kTfLiteInt8:
+        value = (prediction[i] + 128) / 256.0;
+        break;
+      case kTfLiteUInt8:
+        value = prediction[i] / 255.0;
+        break;
+      default:
+        break;
+    }
+    // Only add it if it beats the threshold and has a chance at being in
+    // the top N.
+    if (value < threshold) {
+      continue;
+    }
+
+    top_result_pq.push(std::pair<float, int>(value, i));
+
+    // If at capacity, kick the smallest value out.
+    if (top_result_pq.size() > num_results) {
+      top_result_pq.pop();
+    }
+  }
+
+  // Copy to output vector and reverse into descending order.
+  while (!top_result_pq.empty()) {
+    top_results->push_back(top_result_pq.top());
+    top_result_pq.pop();
+  }
+  std::reverse(top_results->begin(), top_results->end());
+}
+
+// 生产环境的完整识别流程：镜像、缩放到输入尺寸、推理、取 top-1，返回 labels 编号
+inline int classifyImage(tflite::Interpreter* interpreter, std::unique_ptr<tflite::Interpreter>& resizer, QImage image, int output_size)
+{
+    image = image.convertToFormat(QImage::Format_RGB888).mirrored(true, false);
+    formatImageTFLite<uint8_t>(resizer, interpreter->typed_tensor<uint8_t>(interpreter->inputs()[0]), image.bits(),
+                                              image.height(), image.width(), 3, 224, 224, 3, false);
+    interpreter->Invoke();
+    std::vector<std::pair<float, int>> top_results;
+    get_top_n<uint8_t>(interpreter->typed_output_tensor<uint8_t>(0),
+                                                            output_size, 1, 0.01f, &top_results, kTfLiteUInt8);
+    return top_results.empty() ? 0 : top_results[0].second;
+}
+
+#endif // CLASSIFY_H
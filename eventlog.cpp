@@ -0,0 +1,146 @@
+/*
+ *  Copyright (C) 2021 刘臣轩
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "eventlog.h"
+
+#include <QDateTime>
+#include <QSaveFile>
+#include <QTextStream>
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+// 内存中保留的事件数与界面上显示的行数
+static const int eventCapacity = 1000;
+static const int viewCapacity = 200;
+
+// 耗时直方图的桶上界 (ms)，输出时换算为秒
+static const qint64 bucketBounds[] = { 10, 25, 50, 100, 250, 500, 1000, 2500, 5000 };
+static const int bucketCount = sizeof(bucketBounds) / sizeof(bucketBounds[0]);
+
+EventLog::EventLog(QTextEdit* view, const QString& dir, QObject* parent)
+    : QObject(parent)
+    , view(view)
+    , dir(dir)
+    , dirty(false)
+    , events(eventCapacity)
+    , head(0)
+    , size(0)
+{
+    view->document()->setMaximumBlockCount(viewCapacity);
+
+    flushTimer = new QTimer(this);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+    flushTimer->start(10000);
+}
+
+EventLog::~EventLog()
+{
+    flush();
+}
+
+void EventLog::append(const QString& text)
+{
+    view->append(text);
+    events[(head + size) % eventCapacity] = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss ") + text;
+    if (size < eventCapacity)
+        size++;
+    else
+        head = (head + 1) % eventCapacity;
+    dirty = true;
+}
+
+void EventLog::increment(const QString& metric, const QString& labels)
+{
+    counters[metric][labels]++;
+    dirty = true;
+}
+
+void EventLog::describe(const QString& metric, const QString& help)
+{
+    helps[metric] = help;
+}
+
+void EventLog::observe(const QString& stage, qint64 ms)
+{
+    Histogram& histogram = histograms[stage];
+    if (histogram.buckets.isEmpty()) {
+        histogram.buckets.fill(0, bucketCount);
+        histogram.sum = 0;
+        histogram.count = 0;
+    }
+    for (int i = 0; i < bucketCount; i++) {
+        if (ms <= bucketBounds[i])
+            histogram.buckets[i]++;
+    }
+    histogram.sum += ms;
+    histogram.count++;
+    dirty = true;
+}
+
+QString EventLog::prometheus() const
+{
+    QString text;
+    QTextStream out(&text);
+    for (auto metric = counters.constBegin(); metric != counters.constEnd(); ++metric) {
+        if (helps.contains(metric.key()))
+            out << "# HELP " << metric.key() << " " << helps[metric.key()] << "\n";
+        out << "# TYPE " << metric.key() << " counter\n";
+        for (auto series = metric.value().constBegin(); series != metric.value().constEnd(); ++series) {
+            out << metric.key();
+            if (!series.key().isEmpty())
+                out << "{" << series.key() << "}";
+            out << " " << series.value() << "\n";
+        }
+    }
+    // Prometheus 约定耗时以秒为单位
+    if (!histograms.isEmpty()) {
+        out << "# HELP wastesorting_stage_latency_seconds Latency of each stage of a sorting request.\n";
+        out << "# TYPE wastesorting_stage_latency_seconds histogram\n";
+    }
+    for (auto stage = histograms.constBegin(); stage != histograms.constEnd(); ++stage) {
+        const Histogram& histogram = stage.value();
+        for (int i = 0; i < bucketCount; i++)
+            out << "wastesorting_stage_latency_seconds_bucket{stage=\"" << stage.key() << "\",le=\"" << QString::number(bucketBounds[i] / 1000.0) << "\"} " << histogram.buckets[i] << "\n";
+        out << "wastesorting_stage_latency_seconds_bucket{stage=\"" << stage.key() << "\",le=\"+Inf\"} " << histogram.count << "\n";
+        out << "wastesorting_stage_latency_seconds_sum{stage=\"" << stage.key() << "\"} " << QString::number(histogram.sum / 1000.0) << "\n";
+        out << "wastesorting_stage_latency_seconds_count{stage=\"" << stage.key() << "\"} " << histogram.count << "\n";
+    }
+    return text;
+}
+
+void EventLog::flush()
+{
+    if (!dirty)
+        return;
+    dirty = false;
+
+    // QSaveFile 先写临时文件再替换，采集端不会读到写了一半的文件
+    QSaveFile metrics(dir + "/metrics.prom");
+    if (metrics.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        metrics.write(prometheus().toUtf8());
+        metrics.commit();
+    }
+
+    QSaveFile log(dir + "/events.log");
+    if (log.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        for (int i = 0; i < size; i++)
+            log.write((events[(head + i) % eventCapacity] + "\n").toUtf8());
+        log.commit();
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (C) 2021 刘臣轩
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+// 定长的事件日志与运行指标
+// 事件保存在环形缓冲区中，界面上只保留最近的若干行；
+// 计数与各阶段耗时直方图定期写入 Prometheus 文本格式的 metrics.prom（供 node_exporter textfile 采集），
+// 最近的事件写入 events.log
+
+#include <QMap>
+#include <QObject>
+#include <QTextEdit>
+#include <QTimer>
+#include <QVector>
+
+class EventLog : public QObject {
+    Q_OBJECT
+
+public:
+    EventLog(QTextEdit* view, const QString& dir, QObject* parent = nullptr);
+    ~EventLog();
+
+    // 记录一条事件并显示在界面上
+    void append(const QString& text);
+
+    // 计数器加一，labels 形如 category="厨余垃圾"
+    void increment(const QString& metric, const QString& labels = QString());
+
+    // 计数器的说明，输出为 # HELP 行
+    void describe(const QString& metric, const QString& help);
+
+    // 记录某一阶段的耗时 (ms)，metrics.prom 中以秒输出
+    void observe(const QString& stage, qint64 ms);
+
+    QString prometheus() const;
+
+private:
+    QTextEdit* view;
+    QString dir;
+    QTimer* flushTimer;
+    bool dirty;
+
+    QVector<QString> events;
+    int head;
+    int size;
+
+    QMap<QString, QMap<QString, qint64>> counters; // 指标名 -> 标签 -> 值
+    QMap<QString, QString> helps;                  // 指标名 -> 说明
+
+    struct Histogram {
+        QVector<qint64> buckets;
+        qint64 sum;
+        qint64 count;
+    };
+    QMap<QString, Histogram> histograms; // 阶段 -> 直方图
+
+private slots:
+    void flush();
+};
+
+#endif // EVENTLOG_H
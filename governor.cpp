@@ -0,0 +1,184 @@
+/*
+ *  Copyright (C) 2021 刘臣轩
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "governor.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QThread>
+
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+// 识别期间其余线程的 nice 值
+static const int backgroundNice = 10;
+
+Governor::Governor(QObject* parent)
+    : QObject(parent)
+    , mainThread(0)
+    , canRestoreNice(false)
+    , inFlight(false)
+    , waitStart(0)
+    , mediaStart(0)
+    , latencies(200, 0)
+    , latencyIndex(0)
+{
+#ifdef Q_OS_LINUX
+    mainThread = static_cast<int>(syscall(SYS_gettid));
+#endif
+    int cores = QThread::idealThreadCount();
+    uiCores.push_back(0);
+    for (int i = 0; i < cores; i++)
+        allCores.push_back(i);
+    for (int i = 1; i < cores; i++)
+        inferenceCores.push_back(i);
+    // 单核设备无法隔离，只调整优先级
+    if (inferenceCores.empty())
+        inferenceCores = uiCores;
+
+#ifdef Q_OS_LINUX
+    // 普通用户可以调高 nice 值，但调回 0 需要 root 或 RLIMIT_NICE >= 20，否则降级后无法恢复
+    struct rlimit limit;
+    canRestoreNice = geteuid() == 0 || (getrlimit(RLIMIT_NICE, &limit) == 0 && limit.rlim_cur >= 20);
+#endif
+}
+
+QSet<int> Governor::threads()
+{
+    QSet<int> tids;
+#ifdef Q_OS_LINUX
+    for (const QString& name : QDir("/proc/self/task").entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        tids.insert(name.toInt());
+#endif
+    return tids;
+}
+
+void Governor::beginWarmup()
+{
+    warmupThreads = threads();
+}
+
+void Governor::endWarmup()
+{
+    inferenceThreads = threads() - warmupThreads;
+    for (int tid : inferenceThreads)
+        pin(tid, inferenceCores);
+    qDebug() << "识别线程" << inferenceThreads.size() << "个，绑定到" << inferenceCores.size() << "个核心";
+}
+
+void Governor::isolate(bool on)
+{
+    pin(mainThread, on ? inferenceCores : allCores);
+    if (on) {
+        mediaThreads = threads() - inferenceThreads;
+        mediaThreads.remove(mainThread);
+    }
+    for (int tid : mediaThreads) {
+        pin(tid, on ? uiCores : allCores);
+        if (canRestoreNice)
+            setNice(tid, on ? backgroundNice : 0);
+    }
+}
+
+void Governor::beginInference()
+{
+    if (inFlight)
+        return;
+    inFlight = true;
+    latencyTimer.start();
+    isolate(true);
+    QSet<int> foreground = inferenceThreads;
+    foreground.insert(mainThread);
+    waitStart = schedstat(foreground, 1);
+    mediaStart = schedstat(mediaThreads, 0);
+}
+
+InferenceStats Governor::endInference()
+{
+    InferenceStats stats = { -1, 0, 0 };
+    if (!inFlight)
+        return stats;
+    inFlight = false;
+    stats.latency = latencyTimer.elapsed();
+    QSet<int> foreground = inferenceThreads;
+    foreground.insert(mainThread);
+    stats.wait = (schedstat(foreground, 1) - waitStart) / 1000000;
+    stats.media = (schedstat(mediaThreads, 0) - mediaStart) / 1000000;
+    isolate(false);
+
+    latencies[latencyIndex++ % latencies.size()] = stats.latency;
+    std::vector<qint64> sorted(latencies.begin(), latencies.begin() + std::min(latencyIndex, latencies.size()));
+    std::sort(sorted.begin(), sorted.end());
+    qint64 p99 = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+    qDebug() << "识别耗时" << stats.latency << "ms, 等待CPU" << stats.wait << "ms, 其余线程占用" << stats.media << "ms, p99" << p99 << "ms";
+    return stats;
+}
+
+bool Governor::pin(int tid, const std::vector<int>& cores)
+{
+#ifdef Q_OS_LINUX
+    if (!tid)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core : cores)
+        CPU_SET(core, &set);
+    return sched_setaffinity(tid, sizeof(set), &set) == 0;
+#else
+    Q_UNUSED(tid);
+    Q_UNUSED(cores);
+    return false;
+#endif
+}
+
+bool Governor::setNice(int tid, int nice)
+{
+#ifdef Q_OS_LINUX
+    // Linux 下 setpriority 对单个线程生效
+    return setpriority(PRIO_PROCESS, tid, nice) == 0;
+#else
+    Q_UNUSED(tid);
+    Q_UNUSED(nice);
+    return false;
+#endif
+}
+
+// /proc/self/task/<tid>/schedstat: 运行时间(ns) 就绪等待时间(ns) 调度次数
+qint64 Governor::schedstat(const QSet<int>& tids, int field)
+{
+    qint64 sum = 0;
+    for (int tid : tids) {
+        QFile file(QString("/proc/self/task/%1/schedstat").arg(tid));
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        QList<QByteArray> fields = file.readAll().split(' ');
+        if (fields.size() > field)
+            sum += fields[field].toLongLong();
+    }
+    return sum;
+}
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (C) 2021 刘臣轩
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+// CPU 资源分配：TFLite 工作线程固定在 1..n-1 号核心；识别期间主线程（调用 Invoke，自己也承担一份计算）
+// 也移到这些核心，视频解码等其余线程限制在 0 号核心并在允许时降低优先级，识别结束后恢复。
+// 同时统计每次识别的耗时与 CPU 争用情况
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSet>
+
+#include <vector>
+
+struct InferenceStats {
+    qint64 latency; // 从触发到识别完成 (ms)，未在识别中时为 -1
+    qint64 wait;    // 识别线程与主线程在就绪队列中等待 CPU 的时间 (ms)
+    qint64 media;   // 同期其余线程占用的 CPU 时间 (ms)
+};
+
+class Governor : public QObject {
+    Q_OBJECT
+
+public:
+    Governor(QObject* parent = nullptr);
+
+    // 当前进程的所有线程 id
+    static QSet<int> threads();
+
+    // 解释器的线程数，等于隔离出来的核心数
+    int inferenceThreadCount() const { return int(inferenceCores.size()); }
+
+    // 在创建解释器之前与预热之后各调用一次，两次之间新建的线程即 TFLite 的工作线程
+    void beginWarmup();
+    void endWarmup();
+
+    // 从触发拍照到识别完成
+    void beginInference();
+    InferenceStats endInference();
+    bool inferenceInFlight() const { return inFlight; }
+
+private:
+    int mainThread;
+    QSet<int> inferenceThreads;
+    QSet<int> mediaThreads;
+    QSet<int> warmupThreads;
+    std::vector<int> uiCores;
+    std::vector<int> inferenceCores;
+    std::vector<int> allCores;
+    bool canRestoreNice;
+
+    bool inFlight;
+    QElapsedTimer latencyTimer;
+    qint64 waitStart;
+    qint64 mediaStart;
+    std::vector<qint64> latencies; // 最近的识别耗时 (ms)，环形
+    size_t latencyIndex;
+
+    static bool pin(int tid, const std::vector<int>& cores);
+    static bool setNice(int tid, int nice);
+    void isolate(bool on);
+    static qint64 schedstat(const QSet<int>& tids, int field);
+};
+
+#endif // GOVERNOR_H
@@ -18,6 +18,7 @@
 #include "widget.h"
 
 #include <QApplication>
+#include <QTimer>
 
 int main(int argc, char* argv[])
 {
@@ -25,5 +26,9 @@ int main(int argc, char* argv[])
     Widget w;
     w.setWindowFlag(Qt::FramelessWindowHint);
     w.show();
+    // WASTESORTING_SELFCHECK=N 时识别 N 次后退出，退出码为自检结果
+    int selfCheck = qEnvironmentVariableIntValue("WASTESORTING_SELFCHECK");
+    if (selfCheck > 0)
+        QTimer::singleShot(0, &w, [&w, selfCheck]() { QApplication::exit(w.selfCheck(selfCheck)); });
     return a.exec();
 }
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (C) 2021 刘臣轩
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memoryguard.h"
+
+#include <QDebug>
+#include <QFile>
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+static const qint64 MB = 1024 * 1024;
+
+MemoryGuard::MemoryGuard(QObject* parent)
+    : QObject(parent)
+    , budget(0)
+    , lastRss(rss())
+    , underPressure(false)
+{
+    bool ok = false;
+    qint64 mb = qEnvironmentVariableIntValue("WASTESORTING_RSS_BUDGET_MB", &ok);
+    if (ok)
+        budget = mb * MB;
+    else if (totalMemory() > 0 && totalMemory() <= 512 * MB)
+        budget = 200 * MB;
+
+    usage.append({ "Qt 与界面", lastRss });
+
+    checkTimer = new QTimer(this);
+    connect(checkTimer, SIGNAL(timeout()), this, SLOT(check()));
+    if (budget > 0)
+        checkTimer->start(5000);
+}
+
+// /proc/self/status 与 /proc/meminfo 中的字段形如 "VmRSS:    12345 kB"
+qint64 MemoryGuard::status(const char* field)
+{
+    QFile file(QString(field) == "MemTotal" ? "/proc/meminfo" : "/proc/self/status");
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+    QByteArray prefix = QByteArray(field) + ":";
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine();
+        if (line.startsWith(prefix))
+            return line.mid(prefix.size()).simplified().split(' ').value(0).toLongLong() * 1024;
+    }
+    return 0;
+}
+
+qint64 MemoryGuard::rss()
+{
+    return status("VmRSS");
+}
+
+qint64 MemoryGuard::peakRss()
+{
+    return status("VmHWM");
+}
+
+qint64 MemoryGuard::totalMemory()
+{
+    return status("MemTotal");
+}
+
+void MemoryGuard::mark(const QString& subsystem)
+{
+    qint64 current = rss();
+    usage.append({ subsystem, current - lastRss });
+    lastRss = current;
+}
+
+QStringList MemoryGuard::report() const
+{
+    QStringList lines;
+    for (const QPair<QString, qint64>& item : usage)
+        lines.append(QString("%1: %2 MB").arg(item.first).arg(item.second / double(MB), 0, 'f', 1));
+    lines.append(QString("合计 %1 MB，峰值 %2 MB，预算 %3")
+                     .arg(rss() / double(MB), 0, 'f', 1)
+                     .arg(peakRss() / double(MB), 0, 'f', 1)
+                     .arg(budget > 0 ? QString::number(budget / MB) + " MB" : "不限"));
+    return lines;
+}
+
+void MemoryGuard::check()
+{
+    qint64 current = rss();
+    if (!underPressure && current > budget) {
+        underPressure = true;
+        qDebug() << "内存超出预算" << current / MB << "MB >" << budget / MB << "MB";
+        emit pressure();
+    } else if (underPressure && current < budget * 9 / 10) {
+        // 回落到预算的 90% 以下后才再次触发，避免反复释放
+        underPressure = false;
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (C) 2021 刘臣轩
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORYGUARD_H
+#define MEMORYGUARD_H
+
+// 内存预算：启动时统计各子系统占用的内存，运行中 RSS 超出预算时发出 pressure()，
+// 由 Widget 释放视频、图片缓存等可选部分
+//
+// 预算由环境变量 WASTESORTING_RSS_BUDGET_MB 指定；未指定时，
+// 内存不超过 512 MB 的设备默认 200 MB，其余设备不限制
+
+#include <QObject>
+#include <QPair>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+
+class MemoryGuard : public QObject {
+    Q_OBJECT
+
+public:
+    MemoryGuard(QObject* parent = nullptr);
+
+    // 单位均为字节，读取失败时返回 0
+    static qint64 rss();
+    static qint64 peakRss();
+    static qint64 totalMemory();
+
+    bool lowMemory() const { return budget > 0; }
+    qint64 rssBudget() const { return budget; }
+
+    // 记录自上一次 mark 以来 subsystem 新增的内存
+    void mark(const QString& subsystem);
+    QStringList report() const;
+
+signals:
+    void pressure();
+
+private:
+    qint64 budget;
+    qint64 lastRss;
+    bool underPressure;
+    QVector<QPair<QString, qint64>> usage;
+    QTimer* checkTimer;
+
+    static qint64 status(const char* field);
+
+private slots:
+    void check();
+};
+
+#endif // MEMORYGUARD_H
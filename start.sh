@@ -1,2 +1,3 @@
 cd /home/pi/Desktop
-./WasteSorting 2>&1 | tee log.log
\ No newline at end of file
+# 事件与指标见 /home/pi/WasteSorting/events.log 与 metrics.prom，标准输出交给 syslog 轮转
+./WasteSorting 2>&1 | logger -t WasteSorting
\ No newline at end of file
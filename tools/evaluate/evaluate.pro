@@ -0,0 +1,20 @@
+QT       += core gui gui-private concurrent
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+    main.cpp
+
+HEADERS += \
+    ../../classify.h \
+    ../../tensorflow.h
+
+INCLUDEPATH += ../..
+
+INCLUDEPATH += /home/pi/tensorflow \
+               /home/pi/tensorflow/tensorflow/lite/tools/make/downloads/flatbuffers/include
+LIBS += -L/home/pi/tensorflow/tensorflow/lite/tools/make/gen/rpi_armv7l/lib
+LIBS += -ltensorflow-lite -ldl -lpthread
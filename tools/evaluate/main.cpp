@@ -0,0 +1,320 @@
+/*
+ *  Copyright (C) 2021 刘臣轩
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// 模型版本评估：用 tensorflow/backup 下所有 *-samples.zip 样本评估每个版本的 model.tflite
+// 图片直接从 zip 中读取，不解压；识别流程与 Widget::onImageCaptured 完全相同
+// 准确率由所有核心并行统计，耗时则按运行时的配置（单个多线程解释器）串行测量
+//
+// 用法: evaluate [tensorflow 目录] [-j 线程数]
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QRegularExpression>
+#include <QTextCodec>
+#include <QTextStream>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtGui/private/qzipreader_p.h>
+
+#include "classify.h"
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+struct Sample {
+    QString label;   // 样本所属物品，取自压缩包文件名，如 "易拉罐"
+    QString archive;
+    QByteArray data; // 压缩包中的原始 jpg 数据
+};
+
+struct ModelResult {
+    QString version;
+    bool loaded;    // 模型与解释器都创建成功
+    bool labelled;  // 标签数与模型输出一致时才统计准确率与混淆
+    int total;
+    int skipped;    // 无法解码的图片数
+    int correct;
+    QHash<QString, QHash<QString, int>> confusion; // 实际类别 -> 识别类别 -> 数量
+    std::vector<qint64> latency;                   // 与运行时相同配置下每张图片的识别耗时 (ns)
+};
+
+// 与 Widget 相同配置的解释器：Governor 留出 0 号核心，其余核心各一个线程
+static const int productionThreads = qMax(1, QThread::idealThreadCount() - 1);
+// 测耗时用的样本数
+static const int latencySamples = 100;
+
+static QTextStream out(stdout);
+
+// 与 label_image.py 的 loadLabels 相同格式: "编号 名称"
+static QStringList loadLabels(const QString& path)
+{
+    QStringList labels;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return labels;
+    QRegularExpression re("^\\s*(\\d+)\\s*(.+)$");
+    QTextStream in(&file);
+    in.setCodec("UTF-8");
+    while (!in.atEnd()) {
+        QRegularExpressionMatch match = re.match(in.readLine());
+        if (!match.hasMatch())
+            continue;
+        int index = match.captured(1).toInt();
+        while (labels.size() <= index)
+            labels.append(QString());
+        labels[index] = match.captured(2).trimmed();
+    }
+    return labels;
+}
+
+// Teachable Machine 工程文件中的样本名形如 "易拉罐-!-0.jpg"（UTF-8 文件名），
+// 类别按首次出现的顺序即为模型输出的编号
+static QStringList loadProjectLabels(const QString& path)
+{
+    QStringList labels;
+    QZipReader zip(path);
+    if (!zip.isReadable())
+        return labels;
+    for (const QZipReader::FileInfo& info : zip.fileInfoList()) {
+        int end = info.filePath.indexOf("-!-");
+        if (end < 0)
+            continue;
+        QString name = info.filePath.left(end);
+        if (!labels.contains(name))
+            labels.append(name);
+    }
+    return labels;
+}
+
+static QVector<Sample> loadSamples(const QString& backupDir)
+{
+    QVector<Sample> samples;
+    QDirIterator it(backupDir, QStringList() << "*-samples*.zip", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString path = it.next();
+        QString fileName = QFileInfo(path).fileName();
+        QString label = fileName.left(fileName.indexOf("-samples"));
+        QZipReader zip(path);
+        if (!zip.isReadable()) {
+            qWarning() << "无法读取" << path;
+            continue;
+        }
+        for (const QZipReader::FileInfo& info : zip.fileInfoList()) {
+            if (!info.isFile)
+                continue;
+            samples.append({ label, path, zip.fileData(info.filePath) });
+        }
+    }
+    return samples;
+}
+
+static QString categoryOf(const QString& label, const QStringList& productionLabels)
+{
+    int index = productionLabels.indexOf(label);
+    return index < 0 ? "未收录" : cateName(index);
+}
+
+// 创建并分配解释器，失败时返回空指针
+static std::unique_ptr<tflite::Interpreter> buildInterpreter(const tflite::FlatBufferModel& model,
+                                                             const tflite::OpResolver& resolver, int threads)
+{
+    std::unique_ptr<tflite::Interpreter> interpreter;
+    if (tflite::InterpreterBuilder(model, resolver)(&interpreter) != kTfLiteOk || !interpreter)
+        return nullptr;
+    interpreter->SetNumThreads(threads);
+    if (interpreter->AllocateTensors() != kTfLiteOk)
+        return nullptr;
+    return interpreter;
+}
+
+static ModelResult evaluate(const QString& version, const QString& modelFile, const QStringList& labels,
+                            const QStringList& productionLabels, const QVector<Sample>& samples, int threads)
+{
+    ModelResult result;
+    result.version = version;
+    result.loaded = false;
+    result.labelled = false;
+    result.total = 0;
+    result.skipped = 0;
+    result.correct = 0;
+
+    std::unique_ptr<tflite::FlatBufferModel> model = tflite::FlatBufferModel::BuildFromFile(modelFile.toLocal8Bit().constData());
+    if (!model) {
+        qWarning() << "无法加载模型" << modelFile;
+        return result;
+    }
+
+    // 耗时：一个多线程解释器串行识别，与 Widget 的配置相同
+    tflite::ops::builtin::BuiltinOpResolver resolver;
+    std::unique_ptr<tflite::Interpreter> interpreter = buildInterpreter(*model, resolver, productionThreads);
+    if (!interpreter) {
+        qWarning() << "无法创建解释器" << modelFile;
+        return result;
+    }
+    result.loaded = true;
+    TfLiteIntArray* output_dims = interpreter->tensor(interpreter->outputs()[0])->dims;
+    int output_size = output_dims->data[output_dims->size - 1];
+    std::unique_ptr<tflite::Interpreter> resizer;
+    QElapsedTimer timer;
+    int step = qMax(1, samples.size() / latencySamples);
+    for (int i = 0; i < samples.size(); i += step) {
+        QImage image = QImage::fromData(samples[i].data);
+        if (image.isNull())
+            continue;
+        timer.start();
+        classifyImage(interpreter.get(), resizer, image, output_size);
+        result.latency.push_back(timer.nsecsElapsed());
+    }
+    interpreter.reset();
+
+    // 准确率：每个线程一个单线程解释器，共享只读的模型
+    std::vector<int> predictions(samples.size(), -1);
+    QVector<QFuture<void>> futures;
+    for (int t = 0; t < threads; t++) {
+        futures.append(QtConcurrent::run([&, t]() {
+            tflite::ops::builtin::BuiltinOpResolver resolver;
+            std::unique_ptr<tflite::Interpreter> interpreter = buildInterpreter(*model, resolver, 1);
+            std::unique_ptr<tflite::Interpreter> resizer;
+            for (int i = t; interpreter && i < samples.size(); i += threads) {
+                QImage image = QImage::fromData(samples[i].data);
+                if (image.isNull())
+                    continue;
+                predictions[i] = classifyImage(interpreter.get(), resizer, image, output_size);
+            }
+        }));
+    }
+    for (QFuture<void>& future : futures)
+        future.waitForFinished();
+    // 标签对不上时准确率没有意义，只报告耗时
+    result.labelled = output_size == labels.size();
+    if (!result.labelled)
+        qWarning() << version << "模型输出" << output_size << "类，标签" << labels.size() << "个，跳过准确率统计";
+
+    for (int i = 0; i < samples.size(); i++) {
+        if (predictions[i] < 0) {
+            result.skipped++;
+            continue;
+        }
+        result.total++;
+        if (!result.labelled)
+            continue;
+        QString predicted = predictions[i] < labels.size() ? labels[predictions[i]] : QString();
+        if (predicted == samples[i].label)
+            result.correct++;
+        result.confusion[categoryOf(samples[i].label, productionLabels)][categoryOf(predicted, productionLabels)]++;
+    }
+    std::sort(result.latency.begin(), result.latency.end());
+    return result;
+}
+
+static double percentile(const std::vector<qint64>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[index] / 1e6;
+}
+
+static void report(const ModelResult& result)
+{
+    const QStringList categories = { "有害垃圾", "可回收垃圾", "厨余垃圾", "其他垃圾", "识别失败", "未收录" };
+    double mean = 0;
+    for (qint64 ns : result.latency)
+        mean += ns / 1e6;
+    if (!result.latency.empty())
+        mean /= result.latency.size();
+
+    out << "== " << result.version << " ==\n";
+    if (!result.loaded) {
+        out << "模型加载失败，未评估\n" << endl;
+        return;
+    }
+    if (result.skipped)
+        out << "无法解码的图片: " << result.skipped << " 张，未计入统计\n";
+    out << QString("%1 线程延迟(ms, %2 张串行): 平均 %3  p50 %4  p99 %5\n").arg(productionThreads).arg(int(result.latency.size())).arg(mean, 0, 'f', 1).arg(percentile(result.latency, 0.5), 0, 'f', 1).arg(percentile(result.latency, 0.99), 0, 'f', 1);
+    if (!result.labelled) {
+        out << "无可用标签，未统计准确率与类别混淆\n" << endl;
+        return;
+    }
+    out << QString("top-1 准确率: %1/%2 (%3%)\n").arg(result.correct).arg(result.total).arg(result.total ? 100.0 * result.correct / result.total : 0, 0, 'f', 1);
+    out << "类别混淆 (行: 实际, 列: 识别)\n";
+    out << QString("%1").arg("", 10);
+    for (const QString& column : categories)
+        out << QString("%1").arg(column, 10);
+    out << "\n";
+    for (const QString& row : categories) {
+        if (!result.confusion.contains(row))
+            continue;
+        out << QString("%1").arg(row, 10);
+        for (const QString& column : categories)
+            out << QString("%1").arg(result.confusion[row].value(column), 10);
+        out << "\n";
+    }
+    out << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+    out.setCodec("UTF-8");
+
+    QString root = "../WasteSorting/tensorflow";
+    int threads = QThread::idealThreadCount();
+    QStringList args = a.arguments();
+    for (int i = 1; i < args.size(); i++) {
+        if (args[i] == "-j" && i + 1 < args.size())
+            threads = qMax(1, args[++i].toInt());
+        else
+            root = args[i];
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(threads);
+
+    QStringList productionLabels = loadLabels(root + "/labels.txt");
+    if (productionLabels.isEmpty()) {
+        qCritical() << "无法读取" << root + "/labels.txt";
+        return 1;
+    }
+
+    QVector<Sample> samples = loadSamples(root + "/backup");
+    out << "样本数: " << samples.size() << "  线程数: " << threads << "\n\n";
+    if (samples.isEmpty())
+        return 1;
+
+    // 当前使用的模型 + backup 下的各个版本
+    QVector<QPair<QString, QString>> versions;
+    versions.append({ "当前", root });
+    QDir backup(root + "/backup");
+    for (const QString& dir : backup.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+        versions.append({ dir, backup.filePath(dir) });
+
+    for (const QPair<QString, QString>& version : versions) {
+        QString modelFile = version.second + "/model.tflite";
+        if (!QFile::exists(modelFile))
+            continue;
+        QStringList labels = loadLabels(version.second + "/labels.txt");
+        if (labels.isEmpty())
+            labels = loadProjectLabels(version.second + "/project.tm");
+        // 没有标签的版本（如 3.15）不能借用当前的 labels.txt，类别顺序未必相同
+        report(evaluate(version.first, modelFile, labels, productionLabels, samples, threads));
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ *  Copyright (C) 2021 刘臣轩
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// 识别部分的峰值内存检查：按 Widget 的方式加载 model.tflite，
+// 用 backup 下的 *-samples.zip 样本跑 classifyImage，峰值 RSS 超出预算时返回非 0
+// 不含界面、视频、摄像头与串口，结果只是整机峰值的下限；整机检查用 WASTESORTING_SELFCHECK 运行客户端
+//
+// 预算与 Widget 相同，取自 WASTESORTING_RSS_BUDGET_MB，未指定时为 200 MB
+// 用法: memcheck [tensorflow 目录] [-n 每个压缩包的样本数]
+
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QTextStream>
+#include <QThread>
+#include <QtGui/private/qzipreader_p.h>
+
+#include "classify.h"
+#include "memoryguard.h"
+
+#if _MSC_VER >= 1600
+#pragma execution_character_set("utf-8")
+#endif
+
+static const qint64 MB = 1024 * 1024;
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+    out.setCodec("UTF-8");
+
+    QString root = "../WasteSorting/tensorflow";
+    int perArchive = 20;
+    QStringList args = a.arguments();
+    for (int i = 1; i < args.size(); i++) {
+        if (args[i] == "-n" && i + 1 < args.size())
+            perArchive = qMax(1, args[++i].toInt());
+        else
+            root = args[i];
+    }
+
+    MemoryGuard guard;
+    qint64 budget = guard.lowMemory() ? guard.rssBudget() : 200 * MB;
+
+    std::unique_ptr<tflite::FlatBufferModel> model = tflite::FlatBufferModel::BuildFromFile((root + "/model.tflite").toLocal8Bit().constData());
+    if (!model) {
+        out << "无法加载模型 " << root << "/model.tflite" << endl;
+        return 2;
+    }
+    tflite::ops::builtin::BuiltinOpResolver resolver;
+    std::unique_ptr<tflite::Interpreter> interpreter;
+    tflite::InterpreterBuilder(*model, resolver)(&interpreter);
+    interpreter->SetNumThreads(qMax(1, QThread::idealThreadCount() - 1));
+    interpreter->AllocateTensors();
+    TfLiteIntArray* output_dims = interpreter->tensor(interpreter->outputs()[0])->dims;
+    int output_size = output_dims->data[output_dims->size - 1];
+    guard.mark("模型");
+
+    // 逐张解码、识别后丢弃，与运行时一样不在内存中保留样本；缩放用的解释器与运行时一样一直保留
+    std::unique_ptr<tflite::Interpreter> resizer;
+    int count = 0;
+    QDirIterator it(root + "/backup", QStringList() << "*-samples*.zip", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QZipReader zip(it.next());
+        int done = 0;
+        for (const QZipReader::FileInfo& info : zip.fileInfoList()) {
+            if (!info.isFile || done >= perArchive)
+                continue;
+            QImage image = QImage::fromData(zip.fileData(info.filePath));
+            if (image.isNull())
+                continue;
+            classifyImage(interpreter.get(), resizer, image, output_size);
+            done++;
+        }
+        count += done;
+    }
+    guard.mark("识别");
+    if (!count) {
+        out << "没有可用的样本" << endl;
+        return 2;
+    }
+
+    for (const QString& line : guard.report())
+        out << line << "\n";
+    qint64 peak = MemoryGuard::peakRss();
+    out << QString("识别 %1 张，峰值 RSS %2 MB，预算 %3 MB")
+               .arg(count)
+               .arg(peak / double(MB), 0, 'f', 1)
+               .arg(budget / MB)
+        << endl;
+    if (peak > budget) {
+        out << "超出预算" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,22 @@
+QT       += core gui gui-private
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+    main.cpp \
+    ../../memoryguard.cpp
+
+HEADERS += \
+    ../../classify.h \
+    ../../memoryguard.h \
+    ../../tensorflow.h
+
+INCLUDEPATH += ../..
+
+INCLUDEPATH += /home/pi/tensorflow \
+               /home/pi/tensorflow/tensorflow/lite/tools/make/downloads/flatbuffers/include
+LIBS += -L/home/pi/tensorflow/tensorflow/lite/tools/make/gen/rpi_armv7l/lib
+LIBS += -ltensorflow-lite -ldl -lpthread
@@ -18,14 +18,32 @@
 #include "widget.h"
 #include "ui_widget.h"
 
+// 拍照分辨率，缩放用的解释器按此尺寸预先分配
+static const int captureWidth = 640;
+static const int captureHeight = 480;
+
 Widget::Widget(QWidget* parent)
     : QWidget(parent)
     , ui(new Ui::Widget)
 {
     ui->setupUi(this);
+    memoryGuard = new MemoryGuard(this);
+    connect(memoryGuard, SIGNAL(pressure()), this, SLOT(releaseMemory()));
+    if (memoryGuard->lowMemory()) {
+        // 背景图解码后每张约 3.5 MB，低内存模式下只缓存当前用到的
+        QPixmapCache::setCacheLimit(4096);
+    }
+#ifdef Q_OS_WIN
+    eventLog = new EventLog(ui->textEdit, "../WasteSorting", this);
+#else
+    eventLog = new EventLog(ui->textEdit, "/home/pi/WasteSorting", this);
+#endif
+    eventLog->describe("wastesorting_items_total", "Items sorted, by waste category.");
+    eventLog->describe("wastesorting_failures_total", "Sorting requests that failed to capture or classify.");
+    eventLog->describe("wastesorting_alarms_total", "Bin alarms reported by the controller, by type.");
     connect(ui->pushButton, SIGNAL(clicked()), this, SLOT(close()));
     ui->frame->setStyleSheet("#frame {border-image: url(:/new/prefix1/image/主.png);}");
-    ui->textEdit->append("开始初始化设备");
+    eventLog->append("开始初始化设备");
 
     // Time
     QTimer* timer = new QTimer(this);
@@ -33,11 +51,12 @@ Widget::Widget(QWidget* parent)
     timer->start(500);
 
     initSerial();
+    memoryGuard->mark("串口");
 #ifdef Q_OS_WIN
     initCamera();
 #else
     connect(this, SIGNAL(imageCaptured(int, QImage)), this, SLOT(onImageCaptured(int, QImage)));
-    ui->textEdit->append("摄像头初始化成功");
+    eventLog->append("摄像头初始化成功");
 #endif
 
     // Network
@@ -46,14 +65,39 @@ Widget::Widget(QWidget* parent)
     networkRequest->setHeader(QNetworkRequest::ContentTypeHeader, "	application/json;charset=UTF-8");
     url = new QUrl("https://aiapi.jd.com/jdai/garbageImageSearch");
     connect(networkManager, SIGNAL(finished(QNetworkReply*)), this, SLOT(onRequestFinished(QNetworkReply*)));
+    memoryGuard->mark("网络");
 
     ui->label_3->setText("工训大赛");
     ui->label_4->setStyleSheet("border-image: url(:/new/prefix1/image/工训大赛.png);\nborder-radius: 10px;\n");
     ui->label_4->setVisible(true);
     ui->label_5->setVisible(false);
-    ui->textEdit->append("设备初始化成功√");
+    eventLog->append("设备初始化成功√");
     number = 0;
 
+    // 模型预热要在创建视频播放器之前，否则 GStreamer 异步启动的线程会被误当作识别线程
+    governor = new Governor(this);
+#ifdef Q_OS_WIN
+#else
+    // Tensorflow
+    // 从创建解释器到预热结束之间新建的线程即 TFLite 的工作线程
+    governor->beginWarmup();
+    // BuildFromFile 通过 mmap 直接使用模型文件，不复制；模型的张量在 AllocateTensors 时一次分配好
+    model = tflite::FlatBufferModel::BuildFromFile(model_file.c_str());
+    tflite::InterpreterBuilder(*model, resolver)(&interpreter);
+    // 线程数与隔离出来的核心数相同，主线程识别期间也在这些核心上
+    interpreter->SetNumThreads(governor->inferenceThreadCount());
+    interpreter->AllocateTensors();
+    input_tensor = interpreter->tensor(interpreter->inputs()[0]);
+    TfLiteIntArray* output_dims = interpreter->tensor(interpreter->outputs()[0])->dims;
+    output_size = output_dims->data[output_dims->size - 1];
+    // 用一帧拍照尺寸的空白图片预热，同时按拍照尺寸创建缩放用的解释器（约 3.7 MB 浮点张量），之后一直保留，不再重新分配
+    QImage blank(captureWidth, captureHeight, QImage::Format_RGB888);
+    blank.fill(Qt::black);
+    classifyImage(interpreter.get(), resizer, blank, output_size);
+    governor->endWarmup();
+    memoryGuard->mark("模型");
+#endif
+
     // Video
     player = new QMediaPlayer;
     videoWidget = new QVideoWidget(this);
@@ -73,18 +117,10 @@ Widget::Widget(QWidget* parent)
     connect(videoTimer, SIGNAL(timeout()), this, SLOT(videoTimerUpdate()));
     videoTimer->setSingleShot(true);
     videoTimer->start(10000);
+    memoryGuard->mark("视频");
 
-#ifdef Q_OS_WIN
-#else
-    // Tensorflow
-    model = tflite::FlatBufferModel::BuildFromFile(model_file.c_str());
-    tflite::InterpreterBuilder(*model, resolver)(&interpreter);
-    interpreter->SetNumThreads(4);
-    interpreter->AllocateTensors();
-    input_tensor = interpreter->tensor(interpreter->inputs()[0]);
-    TfLiteIntArray* output_dims = interpreter->tensor(interpreter->outputs()[0])->dims;
-    output_size = output_dims->data[output_dims->size - 1];
-#endif
+    for (const QString& line : memoryGuard->report())
+        eventLog->append(line);
     //captureImage();
 }
 
@@ -101,16 +137,28 @@ void Widget::timerUpdate()
 
 void Widget::videoTimerUpdate()
 {
+    // 内存不足时播放器已被释放
+    if (governor->inferenceInFlight() || !player)
+        return;
     ui->label_4->setVisible(false);
     player->play();
     videoWidget->setVisible(true);
     ui->label_3->setText("播放视频");
-    ui->textEdit->append("播放视频");
+    eventLog->append("播放视频");
+}
+
+void Widget::stopVideo()
+{
+    videoTimer->stop();
+    if (!player)
+        return;
+    videoWidget->setVisible(false);
+    player->stop();
 }
 
 void Widget::initSerial()
 {
-    ui->textEdit->append("开始初始化串口");
+    eventLog->append("开始初始化串口");
     serialPort = new QSerialPort();
     connect(serialPort, SIGNAL(readyRead()), this, SLOT(serialRead()));
     if (QSerialPortInfo::availablePorts().length() == 0) {
@@ -120,15 +168,15 @@ void Widget::initSerial()
 #ifdef Q_OS_WIN
     QString portName = QSerialPortInfo::availablePorts()[1].portName();
     qDebug() << portName;
-    ui->textEdit->append("尝试连接串口" + portName);
+    eventLog->append("尝试连接串口" + portName);
     serialPort->setPortName(portName);
 #else
     QString portName = "ttyUSB0";
-    ui->textEdit->append("尝试连接串口ttyUSB0");
+    eventLog->append("尝试连接串口ttyUSB0");
     serialPort->setPortName("ttyUSB0");
 #endif
     if (serialPort->open(QIODevice::ReadWrite)) {
-        ui->textEdit->append("串口连接成功");
+        eventLog->append("串口连接成功");
         serialPort->setBaudRate(115200);
         serialPort->setDataBits(QSerialPort::Data8);
         serialPort->setParity(QSerialPort::NoParity);
@@ -137,7 +185,7 @@ void Widget::initSerial()
         QMessageBox::critical(this, "错误", "串口设备" + portName + "无法打开，请检查硬件连接后重试");
         exit(0);
     }
-    ui->textEdit->append("串口初始化成功");
+    eventLog->append("串口初始化成功");
     serialWrite('\xCC');
 }
 
@@ -151,14 +199,15 @@ void Widget::initCamera()
         QMessageBox::critical(this, "错误", "无可用摄像头，请检查硬件连接后重试");
         exit(0);
     }
-    ui->textEdit->append("开始初始化摄像头");
+    eventLog->append("开始初始化摄像头");
     camera = new QCamera(QCameraInfo::availableCameras()[0], this);
     imageCapture = new QCameraImageCapture(camera);
     connect(imageCapture, SIGNAL(imageCaptured(int, QImage)), this, SLOT(onImageCaptured(int, QImage)));
+    connect(imageCapture, SIGNAL(error(int, QCameraImageCapture::Error, QString)), this, SLOT(onCaptureError(int, QCameraImageCapture::Error, QString)));
     camera->setCaptureMode(QCamera::CaptureStillImage);
     imageCapture->setCaptureDestination(QCameraImageCapture::CaptureToBuffer);
     camera->start();
-    ui->textEdit->append("摄像头初始化成功");
+    eventLog->append("摄像头初始化成功");
 }
 
 void Widget::serialRead()
@@ -169,7 +218,7 @@ void Widget::serialRead()
         && buffer[3] == '\xFC' && buffer[4] == '\x03') {
         switch (buffer[2]) {
         case '\x00':
-            ui->textEdit->append("取消警报");
+            eventLog->append("取消警报");
             ui->label_3->setText("取消警报");
             ui->label_4->setVisible(true);
             ui->label_5->setVisible(false);
@@ -177,11 +226,10 @@ void Widget::serialRead()
             videoTimer->start(10000);
             break;
         case '\x01':
-            ui->textEdit->append("触发拍照信号");
+            eventLog->append("触发拍照信号");
             ui->label_3->setText("触发拍照");
-            videoTimer->stop();
-            videoWidget->setVisible(false);
-            player->stop();
+            governor->beginInference();
+            stopVideo();
 #ifdef Q_OS_WIN
             imageCapture->capture();
 #else
@@ -189,7 +237,7 @@ void Widget::serialRead()
 #endif
             break;
         case '\x02':
-            ui->textEdit->append("投递完毕");
+            eventLog->append("投递完毕");
             ui->label_3->setText("投递完毕");
             ui->label_4->setVisible(true);
             ui->label_5->setVisible(false);
@@ -197,22 +245,20 @@ void Widget::serialRead()
             videoTimer->start(10000);
             break;
         case '\x04':
-            ui->textEdit->append("满载警报");
+            eventLog->append("满载警报");
+            eventLog->increment("wastesorting_alarms_total", "type=\"full\"");
             ui->label_3->setText("满载警报");
             ui->label_4->setVisible(false);
-            videoTimer->stop();
-            videoWidget->setVisible(false);
-            player->stop();
+            stopVideo();
             ui->frame->setStyleSheet("#frame {border-image: url(:/new/prefix1/image/满载警报.png);}");
             break;
         case '\x08':
             // qDebug() << "倾倒警报";
-            ui->textEdit->append("倾倒警报");
+            eventLog->append("倾倒警报");
+            eventLog->increment("wastesorting_alarms_total", "type=\"tilt\"");
             ui->label_3->setText("倾倒警报");
             ui->label_4->setVisible(false);
-            videoTimer->stop();
-            videoWidget->setVisible(false);
-            player->stop();
+            stopVideo();
             ui->frame->setStyleSheet("#frame {border-image: url(:/new/prefix1/image/倾倒警报.png);}");
             break;
         case '\xFF':
@@ -280,18 +326,90 @@ void Widget::captureImage()
     // system("raspistill -o ../WasteSorting/WasteSorting.jpg -t 1 -br 60 -hf -awb sun");
     // system("python3 ../WasteSorting/capture.py");
     //system("rm -rf /home/pi/WasteSorting/WasteSorting.jpg");
+    QElapsedTimer timer;
+    timer.start();
+    QImage image = grabFrame();
+    //QImage image("../WasteSorting/WasteSorting.jpg");
+    eventLog->observe("capture", timer.elapsed());
+    emit(imageCaptured(0, image));
+}
+
+QImage Widget::grabFrame()
+{
     capture = cv::VideoCapture(0);
+    capture.set(cv::CAP_PROP_FRAME_WIDTH, captureWidth);
+    capture.set(cv::CAP_PROP_FRAME_HEIGHT, captureHeight);
     cv::Mat frame;
     capture >> frame;
     QImage image = cvMat2QImage(frame);
     capture.release();
     //cv::imwrite("/home/pi/WasteSorting/WasteSorting.jpg", frame);
-    //QImage image("../WasteSorting/WasteSorting.jpg");
-    emit(imageCaptured(0, image));
+    return image;
+}
+
+int Widget::selfCheck(int count)
+{
+    // 先播放视频，等 GStreamer 管线启动
+    videoTimerUpdate();
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < 5000)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+
+#ifdef Q_OS_WIN
+    // Windows 下拍照是异步的，且不使用 TFLite，只检查启动与视频
+    Q_UNUSED(count);
+#else
+    // 与 onImageCaptured 相同的流程，但结果只写日志，不发往串口，不会驱动投递机构
+    for (int i = 0; i < count; i++) {
+        QImage image = grabFrame();
+        if (image.isNull()) {
+            eventLog->append("自检拍照失败");
+            return 2;
+        }
+        governor->beginInference();
+        stopVideo();
+        ui->label_4->setVisible(false);
+        ui->label_5->setPixmap(QPixmap::fromImage(image).scaled(405, 306));
+        ui->label_5->setVisible(true);
+        QString cate_name = cateName(classifyImage(interpreter.get(), resizer, image, output_size));
+        finishInference();
+        eventLog->append(QString("自检 %1/%2 %3").arg(i + 1).arg(count).arg(cate_name));
+        ui->label_5->setVisible(false);
+        videoTimerUpdate();
+        QCoreApplication::processEvents();
+    }
+    memoryGuard->mark("自检");
+#endif
+
+    // 未指定预算时按低内存设备的 200 MB 检查，与 tools/memcheck 相同
+    qint64 budget = memoryGuard->lowMemory() ? memoryGuard->rssBudget() : 200 * 1024 * 1024;
+    bool ok = MemoryGuard::peakRss() <= budget;
+    for (const QString& line : memoryGuard->report())
+        qDebug() << line;
+    qDebug() << (ok ? "自检通过" : "自检失败：峰值 RSS 超出预算");
+    return ok ? 0 : 1;
+}
+
+void Widget::onCaptureError(int, QCameraImageCapture::Error, QString errorString)
+{
+    // 拍照失败时不会再调用 onImageCaptured，按识别失败处理
+    qDebug() << errorString;
+    finishInference();
+    eventLog->append("拍照失败");
+    eventLog->increment("wastesorting_failures_total");
+    serialWrite('\xFD');
+    ui->label_4->setVisible(true);
+    ui->label_5->setVisible(false);
+    ui->frame->setStyleSheet("#frame {border-image: url(:/new/prefix1/image/主.png);}");
+    videoTimer->start(10000);
 }
 
 void Widget::onImageCaptured(int, QImage image)
 {
+    governor->beginInference();
+    stopVideo();
+
     // 显示图片
     ui->label_4->setVisible(false);
     ui->label_5->setPixmap(QPixmap::fromImage(image).scaled(405, 306));
@@ -332,140 +450,37 @@ void Widget::onImageCaptured(int, QImage image)
 
     /* Tensorflow Lite C++ */
     image.save("../WasteSorting/WasteSorting.jpg");
-    image = image.convertToFormat(QImage::Format_RGB888).mirrored(true, false);
-    formatImageTFLite<uint8_t>(interpreter->typed_tensor<uint8_t>(interpreter->inputs()[0]), image.bits(),
-                                              image.height(), image.width(), 3, 224, 224, 3, false);
-    interpreter->Invoke();
-    std::vector<std::pair<float, int>> top_results;
-    get_top_n<uint8_t>(interpreter->typed_output_tensor<uint8_t>(0),
-                                                            output_size, 1, 0.01f, &top_results, kTfLiteUInt8);
-    int index = top_results[0].second;
-    QString cate_name;
-    switch(index) {
-    case 0:
-        cate_name = "识别失败";
-        break;
-    case 1:case 2:case 10:
-        cate_name = "有害垃圾";
-        break;
-    case 3:case 4:case 5:case 11:
-        cate_name = "可回收垃圾";
-        break;
-    case 6:case 7:case 12:case 13:
-        cate_name = "厨余垃圾";
-        break;
-    case 8:case 9:
-        cate_name = "其他垃圾";
-        break;
-    }
+    QElapsedTimer timer;
+    timer.start();
+    QString cate_name = cateName(classifyImage(interpreter.get(), resizer, image, output_size));
+    eventLog->observe("inference", timer.elapsed());
     qDebug() << cate_name;
     classifyFinished(cate_name);
 }
 
-template <class T>
-void Widget::formatImageTFLite(T* out, const uint8_t* in, int image_height, int image_width, int image_channels, int wanted_height, int wanted_width, int wanted_channels, bool input_floating)
+void Widget::releaseMemory()
 {
-   const float input_mean = 127.5f;
-   const float input_std  = 127.5f;
-
-  int number_of_pixels = image_height * image_width * image_channels;
-  std::unique_ptr<tflite::Interpreter> interpreter(new tflite::Interpreter);
-
-  int base_index = 0;
-
-  // two inputs: input and new_sizes
-  interpreter->AddTensors(2, &base_index);
-
-  // one output
-  interpreter->AddTensors(1, &base_index);
-
-  // set input and output tensors
-  interpreter->SetInputs({0, 1});
-  interpreter->SetOutputs({2});
-
-  // set parameters of tensors
-  TfLiteQuantizationParams quant;
-  interpreter->SetTensorParametersReadWrite(0, kTfLiteFloat32, "input",    {1, image_height, image_width, image_channels}, quant);
-  interpreter->SetTensorParametersReadWrite(1, kTfLiteInt32,   "new_size", {2},quant);
-  interpreter->SetTensorParametersReadWrite(2, kTfLiteFloat32, "output",   {1, wanted_height, wanted_width, wanted_channels}, quant);
-
-  tflite::ops::builtin::BuiltinOpResolver resolver;
-  const TfLiteRegistration *resize_op = resolver.FindOp(tflite::BuiltinOperator_RESIZE_BILINEAR,1);
-  auto* params = reinterpret_cast<TfLiteResizeBilinearParams*>(malloc(sizeof(TfLiteResizeBilinearParams)));
-  params->align_corners = false;
-  interpreter->AddNodeWithParameters({0, 1}, {2}, nullptr, 0, params, resize_op, nullptr);
-  interpreter->AllocateTensors();
-
-  // fill input image
-  // in[] are integers, cannot do memcpy() directly
-  auto input = interpreter->typed_tensor<float>(0);
-  for (int i = 0; i < number_of_pixels; i++)
-    input[i] = in[i];
-
-  // fill new_sizes
-  interpreter->typed_tensor<int>(1)[0] = wanted_height;
-  interpreter->typed_tensor<int>(1)[1] = wanted_width;
-
-  interpreter->Invoke();
-
-  auto output = interpreter->typed_tensor<float>(2);
-  auto output_number_of_pixels = wanted_height * wanted_height * wanted_channels;
-
-  for (int i = 0; i < output_number_of_pixels; i++)
-  {
-    if (input_floating)
-      out[i] = (output[i] - input_mean) / input_std;
-    else
-      out[i] = (uint8_t)output[i];
-  }
-}
-
-template <class T>
-void Widget::get_top_n(T* prediction, int prediction_size, size_t num_results,
-               float threshold, std::vector<std::pair<float, int>>* top_results,
-               TfLiteType input_type) {
-  // Will contain top N results in ascending order.
-  std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int>>,
-                      std::greater<std::pair<float, int>>>
-      top_result_pq;
-
-  const long count = prediction_size;  // NOLINT(runtime/int)
-  float value = 0.0;
-
-  for (int i = 0; i < count; ++i) {
-    switch (input_type) {
-      case kTfLiteFloat32:
-        value = prediction[i];
-        break;
-      case kTfLiteInt8:
-        value = (prediction[i] + 128) / 256.0;
-        break;
-      case kTfLiteUInt8:
-        value = prediction[i] / 255.0;
-        break;
-      default:
-        break;
-    }
-    // Only add it if it beats the threshold and has a chance at being in
-    // the top N.
-    if (value < threshold) {
-      continue;
-    }
-
-    top_result_pq.push(std::pair<float, int>(value, i));
-
-    // If at capacity, kick the smallest value out.
-    if (top_result_pq.size() > num_results) {
-      top_result_pq.pop();
+    // 释放播放器及其 GStreamer 管线，之后不再播放视频；正在播放时换回待机图片，警报等其他界面保持不变
+    if (player) {
+        bool playing = videoWidget->isVisible();
+        stopVideo();
+        if (playing)
+            ui->label_4->setVisible(true);
+        player->deleteLater();
+        videoWidget->deleteLater();
+        playList->deleteLater();
+        player = nullptr;
+        videoWidget = nullptr;
+        playList = nullptr;
+        eventLog->append("内存不足，停止播放视频");
     }
-  }
-
-  // Copy to output vector and reverse into descending order.
-  while (!top_result_pq.empty()) {
-    top_results->push_back(top_result_pq.top());
-    top_result_pq.pop();
-  }
-  std::reverse(top_results->begin(), top_results->end());
+    // 缩放用的解释器每帧都要用，释放了下一帧也会重新分配，不在此释放
+    QPixmapCache::clear();
+#ifdef Q_OS_LINUX
+    malloc_trim(0);
+#endif
+    for (const QString& line : memoryGuard->report())
+        qDebug() << line;
 }
 
 void Widget::sendRequest(QByteArray& imageBase64)
@@ -521,6 +536,8 @@ void Widget::onRequestFinished(QNetworkReply* reply)
         classifyFinished(cate_name);
 
     } else {
+        finishInference();
+        eventLog->increment("wastesorting_failures_total");
         serialWrite('\xFD');
         //ui->textEdit->append("识别失败，请重试");
         //ui->label_3->setText("识别失败");
@@ -530,11 +547,23 @@ void Widget::onRequestFinished(QNetworkReply* reply)
     }
 }
 
+void Widget::finishInference()
+{
+    InferenceStats stats = governor->endInference();
+    if (stats.latency < 0)
+        return;
+    eventLog->observe("total", stats.latency);
+    eventLog->observe("cpu_wait", stats.wait);
+    eventLog->observe("other_threads_cpu", stats.media);
+}
+
 void Widget::classifyFinished(QString cate_name)
 {
+    finishInference();
     ui->frame->setStyleSheet("#frame {border-image: url(:/new/prefix1/image/" + cate_name + ".PNG);}");
     ui->label_3->setText("投递中");
     if (cate_name == "识别失败") {
+        eventLog->increment("wastesorting_failures_total");
         serialWrite('\xFD');
         //ui->textEdit->append("识别失败，请重试");
         //ui->label_3->setText("识别失败");
@@ -543,7 +572,8 @@ void Widget::classifyFinished(QString cate_name)
         ui->frame->setStyleSheet("#frame {border-image: url(:/new/prefix1/image/主.png);}");
     }else {
         number += 1;
-        ui->textEdit->append(QString::number(number) + " " + cate_name + " 1 OK!");
+        eventLog->append(QString::number(number) + " " + cate_name + " 1 OK!");
+        eventLog->increment("wastesorting_items_total", "category=\"" + cate_name + "\"");
         if (cate_name == "可回收垃圾")
             serialWrite('\x01');
         else if (cate_name == "厨余垃圾")
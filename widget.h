@@ -34,6 +34,8 @@
 
 #include <QDateTime>
 #include <QTextCodec>
+#include <QElapsedTimer>
+#include <QPixmapCache>
 #include <QTimer>
 
 #include <QSerialPort>
@@ -54,11 +56,18 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 
-#include "tensorflow.h"
+#include "classify.h"
+#include "eventlog.h"
+#include "governor.h"
+#include "memoryguard.h"
 #include "stdint.h"
 
-#include "opencv2/opencv.hpp"
+#include "opencv2/core.hpp"
+#include "opencv2/videoio.hpp"
 #include <sys/stat.h>
+#ifdef Q_OS_LINUX
+#include <malloc.h>
+#endif
 
 #if _MSC_VER >= 1600
 #pragma execution_character_set("utf-8")
@@ -77,13 +86,21 @@ public:
     Widget(QWidget* parent = nullptr);
     ~Widget();
 
+    // 自检：完整启动并播放视频，连续拍照识别 count 次，返回 0 表示峰值 RSS 在预算内，1 表示超出，2 表示拍照失败
+    int selfCheck(int count);
+
 private:
     Ui::Widget* ui;
+    EventLog* eventLog;
+    MemoryGuard* memoryGuard;
 
     QTimer* videoTimer;
     QMediaPlayer* player;
     QVideoWidget* videoWidget;
     QMediaPlaylist* playList;
+    void stopVideo();
+
+    Governor* governor;
 
     QSerialPort* serialPort;
     void initSerial();
@@ -94,12 +111,14 @@ private:
     QCameraImageCapture* imageCapture;
     void initCamera();
     void captureImage();
+    QImage grabFrame();
 
     QNetworkAccessManager* networkManager;
     QNetworkRequest* networkRequest;
     QUrl* url;
     void sendRequest(QByteArray& imageBase64);
     void classifyFinished(QString cate_name);
+    void finishInference();
 
     qint64 number;
 
@@ -108,14 +127,9 @@ private:
     std::string model_file = "../WasteSorting/tensorflow/model.tflite";
     std::unique_ptr<tflite::FlatBufferModel> model;
     std::unique_ptr<tflite::Interpreter> interpreter;
+    std::unique_ptr<tflite::Interpreter> resizer;
     tflite::ops::builtin::BuiltinOpResolver resolver;
     TfLiteTensor* input_tensor;
-    template <class T>
-    void formatImageTFLite(T* out, const uint8_t* in, int image_height, int image_width, int image_channels, int wanted_height, int wanted_width, int wanted_channels, bool input_floating);
-    template <class T>
-    void get_top_n(T* prediction, int prediction_size, size_t num_results,
-                   float threshold, std::vector<std::pair<float, int>>* top_results,
-                   TfLiteType input_type);
     int output_size;
 #endif
     cv::VideoCapture capture;
@@ -124,8 +138,10 @@ private:
 private slots:
     void timerUpdate();
     void videoTimerUpdate();
+    void releaseMemory();
     void serialRead();
     void onImageCaptured(int, QImage image);
+    void onCaptureError(int, QCameraImageCapture::Error, QString errorString);
     void onRequestFinished(QNetworkReply* reply);
 
 signals: